@@ -3,26 +3,474 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "dictlite.h"
 
 
+////////////////////////////////////////
+// Filter
+////////////////////////////////////////
+
+// Counters (and so bits of memory) per key, which with 5 hashes gives a
+// false positive rate of about 1%
+#define FILTER_COUNTERS_PER_KEY 10
+#define FILTER_NUM_HASHES 5
+#define FILTER_MIN_COUNTERS 64
+#define FILTER_COUNTER_MAX 255
+
+static DictliteFilter * dictlite_filter_new(size_t (* hashKey)(void * key), size_t capacity)
+{
+  // Round the number of counters up to a power of 2 so indexes can be masked
+  size_t numCounters = FILTER_MIN_COUNTERS;
+  while (numCounters < capacity * FILTER_COUNTERS_PER_KEY)
+    numCounters *= 2;
+
+  DictliteFilter * filter = (DictliteFilter *) malloc(sizeof(DictliteFilter));
+  if (filter == NULL)
+    return NULL;
+  filter->counters = (unsigned char *) calloc(numCounters, sizeof(unsigned char));
+  if (filter->counters == NULL) {
+    free(filter);
+    return NULL;
+  }
+  filter->hashKey = hashKey;
+  filter->numCounters = numCounters;
+  filter->capacity = numCounters / FILTER_COUNTERS_PER_KEY;
+  filter->stats.lookups = 0;
+  filter->stats.rejections = 0;
+  filter->stats.falsePositives = 0;
+  return filter;
+}
+
+static void dictlite_filter_del(DictliteFilter * filter)
+{
+  if (filter == NULL)
+    return;
+  free(filter->counters);
+  free(filter);
+}
+
+static void dictlite_filter_indexes(DictliteFilter * filter, void * key, size_t * indexes)
+{
+  // Mix the bits (MurmurHash3 finalizer) in case the hash is weak
+  unsigned long long hash = (unsigned long long) (filter->hashKey)(key);
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+
+  // Derive the rest of the hashes by double hashing
+  size_t hash1 = (size_t) hash;
+  size_t hash2 = (size_t) (hash >> 32) | 1;
+  size_t mask = filter->numCounters - 1;
+  int index;
+  for (index = 0; index < FILTER_NUM_HASHES; ++index)
+    indexes[index] = (hash1 + index * hash2) & mask;
+}
+
+static void dictlite_filter_add(DictliteFilter * filter, void * key)
+{
+  size_t indexes[FILTER_NUM_HASHES];
+  dictlite_filter_indexes(filter, key, indexes);
+  int index;
+  for (index = 0; index < FILTER_NUM_HASHES; ++index) {
+    if (filter->counters[indexes[index]] < FILTER_COUNTER_MAX)
+      ++(filter->counters[indexes[index]]);
+  }
+}
+
+static void dictlite_filter_remove(DictliteFilter * filter, void * key)
+{
+  size_t indexes[FILTER_NUM_HASHES];
+  dictlite_filter_indexes(filter, key, indexes);
+  int index;
+  for (index = 0; index < FILTER_NUM_HASHES; ++index) {
+    // Saturated counters have lost count so leave them alone
+    if (filter->counters[indexes[index]] < FILTER_COUNTER_MAX)
+      --(filter->counters[indexes[index]]);
+  }
+}
+
+static int dictlite_filter_mayContain(DictliteFilter * filter, void * key)
+{
+  size_t indexes[FILTER_NUM_HASHES];
+  dictlite_filter_indexes(filter, key, indexes);
+  int index;
+  for (index = 0; index < FILTER_NUM_HASHES; ++index) {
+    if (filter->counters[indexes[index]] == 0)
+      return 0;
+  }
+  return 1;
+}
+
+// Builds a filter over all the keys in the dict
+static DictliteFilter * dictlite_buildFilter(Dictlite * dict, size_t (* hashKey)(void * key), size_t capacity)
+{
+  DictliteFilter * filter = dictlite_filter_new(hashKey, (capacity > dict->size ? capacity : dict->size));
+  if (filter == NULL)
+    return NULL;
+  DictliteItemIterator iterator = dictlite_itemIterator(dict);
+  MappingItem * item;
+  while ((item = dictlite_itemIterator_next(&iterator)))
+    dictlite_filter_add(filter, item->key);
+  return filter;
+}
+
+// Adds a key to the filter of the dict (if any), first rebuilding the
+// filter larger if the dict has outgrown it
+static void dictlite_addToFilter(Dictlite * dict, void * key)
+{
+  DictliteFilter * filter = dict->filter;
+  if (filter == NULL)
+    return;
+  if (dict->size > filter->capacity) {
+    DictliteFilter * larger = dictlite_buildFilter(dict, filter->hashKey, 2 * filter->capacity);
+    if (larger != NULL) {
+      // The key is already in the dict, so it was included in the rebuild
+      larger->stats = filter->stats;
+      dictlite_filter_del(filter);
+      dict->filter = larger;
+      return;
+    }
+    // If allocation failed keep using the overfull filter, which is
+    // still correct, just less effective
+  }
+  dictlite_filter_add(filter, key);
+}
+
+////////////////////////////////////////
+// Radix tree
+////////////////////////////////////////
+
+#define RADIX_MIN_CHILD_CAPACITY 2
+
+static RadixNode * dictlite_radix_newNode(const char * label, size_t labelLength)
+{
+  RadixNode * node = (RadixNode *) malloc(sizeof(RadixNode));
+  if (node == NULL)
+    return NULL;
+  node->label = NULL;
+  if (labelLength > 0) {
+    node->label = (char *) malloc(labelLength);
+    if (node->label == NULL) {
+      free(node);
+      return NULL;
+    }
+    memcpy(node->label, label, labelLength);
+  }
+  node->labelLength = labelLength;
+  node->item = NULL;
+  node->parent = NULL;
+  node->children = NULL;
+  node->numChildren = 0;
+  node->childCapacity = 0;
+  return node;
+}
+
+static void dictlite_radix_delNode(RadixNode * node)
+{
+  free(node->label);
+  free(node->children);
+  free(node);
+}
+
+// Frees a subtree including its mapping items
+static void dictlite_radix_delTree(RadixNode * node)
+{
+  size_t index;
+  for (index = 0; index < node->numChildren; ++index)
+    dictlite_radix_delTree(node->children[index]);
+  free(node->item);
+  dictlite_radix_delNode(node);
+}
+
+// Returns the position of the child whose label starts with the given
+// byte, or, if there is no such child, the position where it would go
+static size_t dictlite_radix_childPosition(RadixNode * node, unsigned char byte, int * found)
+{
+  // Binary search
+  size_t low = 0;
+  size_t high = node->numChildren;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    unsigned char middleByte = (unsigned char) node->children[middle]->label[0];
+    if (middleByte == byte) {
+      *found = 1;
+      return middle;
+    } else if (middleByte < byte) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  *found = 0;
+  return low;
+}
+
+static RadixNode * dictlite_radix_findChild(RadixNode * node, unsigned char byte)
+{
+  int found;
+  size_t position = dictlite_radix_childPosition(node, byte, &found);
+  return (found ? node->children[position] : NULL);
+}
+
+static int dictlite_radix_insertChild(RadixNode * node, size_t position, RadixNode * child)
+{
+  if (node->numChildren == node->childCapacity) {
+    size_t capacity = (node->childCapacity > 0 ?
+		       2 * node->childCapacity :
+		       RADIX_MIN_CHILD_CAPACITY);
+    RadixNode ** children = (RadixNode **) realloc(node->children, capacity * sizeof(RadixNode *));
+    if (children == NULL)
+      return -1;
+    node->children = children;
+    node->childCapacity = capacity;
+  }
+  memmove(node->children + position + 1, node->children + position,
+	  (node->numChildren - position) * sizeof(RadixNode *));
+  node->children[position] = child;
+  ++(node->numChildren);
+  child->parent = node;
+  return 0;
+}
+
+static void dictlite_radix_removeChild(RadixNode * node, RadixNode * child)
+{
+  int found;
+  size_t position = dictlite_radix_childPosition(node, (unsigned char) child->label[0], &found);
+  memmove(node->children + position, node->children + position + 1,
+	  (node->numChildren - position - 1) * sizeof(RadixNode *));
+  --(node->numChildren);
+}
+
+// Returns the length of the common prefix of a label and a key
+static size_t dictlite_radix_commonLength(const char * label, size_t labelLength, const char * key)
+{
+  // Labels contain no null bytes so this stops at the end of the key
+  size_t length = 0;
+  while (length < labelLength && label[length] == key[length])
+    ++length;
+  return length;
+}
+
+static RadixNode * dictlite_radix_findNode(RadixNode * root, const char * key)
+{
+  RadixNode * node = root;
+  while (*key != '\0') {
+    node = dictlite_radix_findChild(node, (unsigned char) *key);
+    if (node == NULL ||
+	dictlite_radix_commonLength(node->label, node->labelLength, key) < node->labelLength)
+      return NULL;
+    key += node->labelLength;
+  }
+  return node;
+}
+
+// Returns the node for a key, creating it (and splitting an edge) if
+// necessary.  Returns null if allocation fails.
+static RadixNode * dictlite_radix_addNode(RadixNode * root, const char * key)
+{
+  RadixNode * node = root;
+  while (*key != '\0') {
+    int found;
+    size_t position = dictlite_radix_childPosition(node, (unsigned char) *key, &found);
+    if (!found) {
+      // Hang the rest of the key off this node
+      RadixNode * child = dictlite_radix_newNode(key, strlen(key));
+      if (child == NULL)
+	return NULL;
+      if (dictlite_radix_insertChild(node, position, child) != 0) {
+	dictlite_radix_delNode(child);
+	return NULL;
+      }
+      return child;
+    }
+
+    RadixNode * child = node->children[position];
+    size_t common = dictlite_radix_commonLength(child->label, child->labelLength, key);
+    if (common < child->labelLength) {
+      // Split the edge at the end of the common prefix
+      RadixNode * middle = dictlite_radix_newNode(child->label, common);
+      if (middle == NULL)
+	return NULL;
+      middle->children = (RadixNode **) malloc(RADIX_MIN_CHILD_CAPACITY * sizeof(RadixNode *));
+      if (middle->children == NULL) {
+	dictlite_radix_delNode(middle);
+	return NULL;
+      }
+      middle->childCapacity = RADIX_MIN_CHILD_CAPACITY;
+      memmove(child->label, child->label + common, child->labelLength - common);
+      child->labelLength -= common;
+      node->children[position] = middle;
+      middle->parent = node;
+      dictlite_radix_insertChild(middle, 0, child);
+      child = middle;
+    }
+    node = child;
+    key += common;
+  }
+  return node;
+}
+
+// Removes a node that no longer holds an item, along with any
+// ancestors that become useless, and merges a remaining node that has
+// no item and a single child into that child
+static void dictlite_radix_prune(RadixNode * root, RadixNode * node)
+{
+  while (node != root && node->item == NULL && node->numChildren == 0) {
+    RadixNode * parent = node->parent;
+    dictlite_radix_removeChild(parent, node);
+    dictlite_radix_delNode(node);
+    node = parent;
+  }
+  if (node != root && node->item == NULL && node->numChildren == 1) {
+    RadixNode * child = node->children[0];
+    char * label = (char *) malloc(node->labelLength + child->labelLength);
+    if (label == NULL)
+      return;  // Leave the tree unmerged, which is still correct
+    memcpy(label, node->label, node->labelLength);
+    memcpy(label + node->labelLength, child->label, child->labelLength);
+    free(child->label);
+    child->label = label;
+    child->labelLength += node->labelLength;
+    // The merged label starts with the same byte so the child takes the
+    // node's position
+    RadixNode * parent = node->parent;
+    int found;
+    size_t position = dictlite_radix_childPosition(parent, (unsigned char) label[0], &found);
+    parent->children[position] = child;
+    child->parent = parent;
+    dictlite_radix_delNode(node);
+  }
+}
+
+// Returns the next node in the subtree in depth-first (and so key)
+// order or null if there are no more
+static RadixNode * dictlite_radix_nextNode(RadixNode * node, RadixNode * root)
+{
+  if (node->numChildren > 0)
+    return node->children[0];
+  while (node != root) {
+    RadixNode * parent = node->parent;
+    int found;
+    size_t position = dictlite_radix_childPosition(parent, (unsigned char) node->label[0], &found);
+    if (position + 1 < parent->numChildren)
+      return parent->children[position + 1];
+    node = parent;
+  }
+  return NULL;
+}
+
+// Returns the first node from the given one on that holds an item
+static RadixNode * dictlite_radix_nextItemNode(RadixNode * node, RadixNode * root)
+{
+  while (node != NULL && node->item == NULL)
+    node = dictlite_radix_nextNode(node, root);
+  return node;
+}
+
 ////////////////////////////////////////
 // Dictlite
 ////////////////////////////////////////
 
-static MappingItem * dictlite_findItem(Dictlite * dict, void * key)
+// Finds the mapping item with the given key and the item before it in
+// the list (null if the found item is first)
+static MappingItem * dictlite_findItemAndPrevious(Dictlite * dict, void * key, MappingItem ** previous)
 {
+  DictliteFilter * filter = dict->filter;
+  if (filter != NULL) {
+    ++(filter->stats.lookups);
+    if (!dictlite_filter_mayContain(filter, key)) {
+      ++(filter->stats.rejections);
+      return NULL;
+    }
+  }
+
+  if (dict->tree != NULL) {
+    RadixNode * node = dictlite_radix_findNode(dict->tree, (const char *) key);
+    *previous = NULL;
+    if (node != NULL && node->item != NULL)
+      return node->item;
+    if (filter != NULL)
+      ++(filter->stats.falsePositives);
+    return NULL;
+  }
+
+  MappingItem * before = NULL;
   MappingItem * item = dict->head;
   while (item != NULL) {
     // Handle errors?
-    if ((dict->compareKeys)(item->key, key) == 0)
+    if ((dict->compareKeys)(item->key, key) == 0) {
+      *previous = before;
       return item;
+    }
+    before = item;
     item = item->next;
   }
+  if (filter != NULL)
+    ++(filter->stats.falsePositives);
   return NULL;
 }
 
+static MappingItem * dictlite_findItem(Dictlite * dict, void * key)
+{
+  MappingItem * previous;
+  return dictlite_findItemAndPrevious(dict, key, &previous);
+}
+
+// Finds the mapping item with the given key and, in a cache, counts the
+// hit or miss and moves the item to the end of the list to mark it as
+// most recently used
+static MappingItem * dictlite_useItem(Dictlite * dict, void * key)
+{
+  if (dict->capacity == 0)
+    return dictlite_findItem(dict, key);
+
+  MappingItem * previous;
+  MappingItem * item = dictlite_findItemAndPrevious(dict, key, &previous);
+  if (item == NULL) {
+    ++(dict->cacheStats.misses);
+    return NULL;
+  }
+  ++(dict->cacheStats.hits);
+  // Leave the order alone while something is iterating over the list
+  if (item != dict->end && dict->orderLocks == 0) {
+    // Unlink the item
+    if (previous == NULL)
+      dict->head = item->next;
+    else
+      previous->next = item->next;
+    // Append the item
+    item->next = NULL;
+    dict->end->next = item;
+    dict->end = item;
+  }
+  return item;
+}
+
+// Removes the least recently used item from a cache and hands its key
+// and value to the eviction function.  Called at the end of an insert.
+static void dictlite_evictItem(Dictlite * dict)
+{
+  MappingItem * item = dict->head;
+  if (item == NULL)
+    return;
+  dict->head = item->next;
+  if (dict->head == NULL)
+    dict->end = NULL;
+  --(dict->size);
+  if (dict->filter != NULL)
+    dictlite_filter_remove(dict->filter, item->key);
+  ++(dict->cacheStats.evictions);
+  // Call the eviction function last, when the new item has been inserted
+  // and the evicted item is no longer in the dict
+  if (dict->onEvict != NULL)
+    (dict->onEvict)(item->key, item->value);
+  free(item);
+}
+
 static MappingItem * dictlite_insertItem(Dictlite * dict, void * key, void * value)
 {
   // Create and populate a new mapping item
@@ -33,6 +481,18 @@ static MappingItem * dictlite_insertItem(Dictlite * dict, void * key, void * val
   item->value = value;
   item->next = NULL;
 
+  if (dict->tree != NULL) {
+    RadixNode * node = dictlite_radix_addNode(dict->tree, (const char *) key);
+    if (node == NULL) {
+      free(item);
+      return NULL;
+    }
+    node->item = item;
+    ++(dict->size);
+    dictlite_addToFilter(dict, key);
+    return item;
+  }
+
   if (dict->head == NULL) {
     // Insert the item as the only item
     dict->head = item;
@@ -44,6 +504,12 @@ static MappingItem * dictlite_insertItem(Dictlite * dict, void * key, void * val
     dict->end = item;
     ++(dict->size);
   }
+  dictlite_addToFilter(dict, key);
+
+  // Bring a full cache back to capacity.  The new item is last so it is
+  // never the one evicted.
+  if (dict->capacity > 0 && dict->size > dict->capacity)
+    dictlite_evictItem(dict);
   return item;
 }
 
@@ -60,12 +526,74 @@ Dictlite * dictlite_new(int (* key_comparison_function)(void * key1, void * key2
   dict->head = NULL;
   dict->end = NULL;
   dict->size = 0;
+  dict->filter = NULL;
+  dict->capacity = 0;
+  dict->onEvict = NULL;
+  dict->cacheStats.hits = 0;
+  dict->cacheStats.misses = 0;
+  dict->cacheStats.evictions = 0;
+  dict->orderLocks = 0;
+  dict->tree = NULL;
   dict->compareKeys = (key_comparison_function != NULL ?
 		       key_comparison_function :
 		       dictlite_identityComparison);
   return dict;
 }
 
+Dictlite * dictlite_newCache(int (* key_comparison_function)(void * key1, void * key2),
+			     size_t (* key_hash_function)(void * key),
+			     size_t capacity,
+			     void (* eviction_function)(void * key, void * value))
+{
+  if (capacity == 0)
+    return NULL;
+  Dictlite * dict = dictlite_new(key_comparison_function);
+  if (dict == NULL)
+    return NULL;
+  dict->capacity = capacity;
+  dict->onEvict = eviction_function;
+  if (key_hash_function != NULL &&
+      dictlite_enableFilter(dict, key_hash_function, capacity + 1) != 0) {
+    dictlite_del(dict);
+    return NULL;
+  }
+  return dict;
+}
+
+static int dictlite_stringComparison(void * key1, void * key2)
+{
+  return strcmp((const char *) key1, (const char *) key2);
+}
+
+Dictlite * dictlite_newRadixTree(void)
+{
+  Dictlite * dict = dictlite_new(dictlite_stringComparison);
+  if (dict == NULL)
+    return NULL;
+  // The root holds the empty key
+  dict->tree = dictlite_radix_newNode(NULL, 0);
+  if (dict->tree == NULL) {
+    free(dict);
+    return NULL;
+  }
+  return dict;
+}
+
+void dictlite_lockOrder(Dictlite * dict)
+{
+  ++(dict->orderLocks);
+}
+
+void dictlite_unlockOrder(Dictlite * dict)
+{
+  --(dict->orderLocks);
+}
+
+DictliteCacheStats dictlite_cacheStats(Dictlite * dict)
+{
+  return dict->cacheStats;
+}
+
 void dictlite_del(Dictlite * dict)
 {
   if (dict == NULL)
@@ -80,6 +608,9 @@ void dictlite_del(Dictlite * dict)
     item = item->next;
     free(toFree);
   }
+  if (dict->tree != NULL)
+    dictlite_radix_delTree(dict->tree);
+  dictlite_filter_del(dict->filter);
   // Delete the dict
   free(dict);
 }
@@ -96,15 +627,39 @@ int dictlite_contains(Dictlite * dict, void * key)
 
 void * dictlite_getValue(Dictlite * dict, void * key)
 {
-  MappingItem * item = dictlite_findItem(dict, key);
+  MappingItem * item = dictlite_useItem(dict, key);
   if (item == NULL)
     return NULL;
   return item->value;
 }
 
+int dictlite_tryGet(Dictlite * dict, void * key, void ** value)
+{
+  MappingItem * item = dictlite_useItem(dict, key);
+  if (item == NULL)
+    return 0;
+  if (value != NULL)
+    *value = item->value;
+  return 1;
+}
+
+void ** dictlite_entry(Dictlite * dict, void * key, int * inserted)
+{
+  MappingItem * item = dictlite_useItem(dict, key);
+  if (inserted != NULL)
+    *inserted = (item == NULL);
+  if (item == NULL) {
+    // Insert a new mapping with a null value
+    item = dictlite_insertItem(dict, key, NULL);
+    if (item == NULL)
+      return NULL;
+  }
+  return &(item->value);
+}
+
 void * dictlite_setValue(Dictlite * dict, void * key, void * value)
 {
-  MappingItem * item = dictlite_findItem(dict, key);
+  MappingItem * item = dictlite_useItem(dict, key);
   if (item == NULL) {
     // Insert a new mapping (don't bother to check whether malloc failed)
     dictlite_insertItem(dict, key, value);
@@ -119,49 +674,288 @@ void * dictlite_setValue(Dictlite * dict, void * key, void * value)
 
 MappingItem * dictlite_delItem(Dictlite * dict, void * key)
 {
-  MappingItem * previous = NULL;
-  MappingItem * current = dict->head;
-  while (current != NULL) {
-    if ((dict->compareKeys)(current->key, key) == 0) {
-      // Remove the mapping item from the list
-      if (previous == NULL) {
-	// The item is the first item so modify the dict
-	dict->head = current->next;
-      } else {
-	// Skip the current item
-	previous->next = current->next;
-      }
-      // Update the end pointer
-      if (current->next == NULL) {
-	dict->end = previous;
-      }
-      // Return the mapping item
-      current->next = NULL;
-      return current;
-    }
+  MappingItem * previous;
+  MappingItem * current = dictlite_findItemAndPrevious(dict, key, &previous);
+  if (current == NULL)
+    return NULL;
+
+  if (dict->tree != NULL) {
+    // Remove the mapping item from the tree
+    RadixNode * node = dictlite_radix_findNode(dict->tree, (const char *) key);
+    node->item = NULL;
+    dictlite_radix_prune(dict->tree, node);
+    --(dict->size);
+    if (dict->filter != NULL)
+      dictlite_filter_remove(dict->filter, current->key);
+    return current;
   }
-  return NULL;
+
+  // Remove the mapping item from the list
+  if (previous == NULL) {
+    // The item is the first item so modify the dict
+    dict->head = current->next;
+  } else {
+    // Skip the current item
+    previous->next = current->next;
+  }
+  // Update the end pointer
+  if (current->next == NULL) {
+    dict->end = previous;
+  }
+  --(dict->size);
+  if (dict->filter != NULL)
+    dictlite_filter_remove(dict->filter, current->key);
+  // Return the mapping item
+  current->next = NULL;
+  return current;
 }
 
 void dictlite_addFromDict(Dictlite * dict, Dictlite * otherDict)
 {
+  // Setting values in a cache reorders it, which could be this iteration
+  dictlite_lockOrder(otherDict);
   DictliteItemIterator iterator = dictlite_itemIterator(otherDict);
   MappingItem * item;
   while ((item = dictlite_itemIterator_next(&iterator))) {
     dictlite_setValue(dict, item->key, item->value);
   }
+  dictlite_unlockOrder(otherDict);
+}
+
+int dictlite_enableFilter(Dictlite * dict, size_t (* key_hash_function)(void * key), size_t expectedSize)
+{
+  if (key_hash_function == NULL)
+    return -1;
+  DictliteFilter * filter = dictlite_buildFilter(dict, key_hash_function, expectedSize);
+  if (filter == NULL)
+    return -1;
+  dictlite_filter_del(dict->filter);
+  dict->filter = filter;
+  return 0;
+}
+
+void dictlite_disableFilter(Dictlite * dict)
+{
+  dictlite_filter_del(dict->filter);
+  dict->filter = NULL;
+}
+
+DictliteFilterStats dictlite_filterStats(Dictlite * dict)
+{
+  if (dict->filter == NULL) {
+    DictliteFilterStats noStats = {0, 0, 0};
+    return noStats;
+  }
+  return dict->filter->stats;
+}
+
+double dictlite_filterFalsePositiveRate(Dictlite * dict)
+{
+  DictliteFilterStats stats = dictlite_filterStats(dict);
+  size_t numAbsent = stats.rejections + stats.falsePositives;
+  if (numAbsent == 0)
+    return 0.0;
+  return (double) stats.falsePositives / (double) numAbsent;
 }
 
 DictliteItemIterator dictlite_itemIterator(Dictlite * dict)
 {
-  DictliteItemIterator iterator = {dict->head};
+  if (dict->tree != NULL)
+    return dictlite_prefixIterator(dict, "");
+  DictliteItemIterator iterator = {dict->head, NULL, NULL};
+  return iterator;
+}
+
+DictliteItemIterator dictlite_prefixIterator(Dictlite * dict, const char * prefix)
+{
+  DictliteItemIterator iterator = {NULL, NULL, NULL};
+  if (dict->tree == NULL)
+    return iterator;
+
+  // Find the root of the subtree of keys with the prefix, which may be
+  // partway along an edge
+  RadixNode * node = dict->tree;
+  while (*prefix != '\0') {
+    node = dictlite_radix_findChild(node, (unsigned char) *prefix);
+    if (node == NULL)
+      return iterator;
+    size_t common = dictlite_radix_commonLength(node->label, node->labelLength, prefix);
+    if (prefix[common] == '\0')
+      break;
+    if (common < node->labelLength)
+      return iterator;
+    prefix += common;
+  }
+  iterator.root = node;
+  iterator.nextNode = dictlite_radix_nextItemNode(node, node);
   return iterator;
 }
 
 MappingItem * dictlite_itemIterator_next(DictliteItemIterator * iterator)
 {
+  if (iterator->nextNode != NULL) {
+    MappingItem * item = iterator->nextNode->item;
+    iterator->nextNode = dictlite_radix_nextItemNode(dictlite_radix_nextNode(iterator->nextNode, iterator->root),
+						     iterator->root);
+    return item;
+  }
   MappingItem * item = iterator->nextItem;
   if (item != NULL)
     iterator->nextItem = item->next;
   return item;
 }
+
+////////////////////////////////////////
+// Serialization
+////////////////////////////////////////
+
+DictliteWriter dictlite_writer(char * buffer, size_t capacity,
+			       int (* flush_function)(void * context, const char * data, size_t length),
+			       void * context)
+{
+  DictliteWriter writer = {buffer, (buffer != NULL ? capacity : 0), 0, flush_function, context, 0};
+  return writer;
+}
+
+int dictlite_writer_flush(DictliteWriter * writer)
+{
+  if (writer->failed)
+    return -1;
+  if (writer->length > 0) {
+    if ((writer->flush)(writer->context, writer->buffer, writer->length) != 0) {
+      writer->failed = 1;
+      return -1;
+    }
+    writer->length = 0;
+  }
+  return 0;
+}
+
+int dictlite_writer_write(DictliteWriter * writer, const char * data, size_t length)
+{
+  if (writer->failed)
+    return -1;
+  if (length == 0)
+    return 0;
+  if (length <= writer->capacity - writer->length) {
+    // Common case: room in the buffer
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+    return 0;
+  }
+  if (dictlite_writer_flush(writer) != 0)
+    return -1;
+  if (length <= writer->capacity) {
+    memcpy(writer->buffer, data, length);
+    writer->length = length;
+    return 0;
+  }
+  // Too big to buffer so pass it through
+  if ((writer->flush)(writer->context, data, length) != 0) {
+    writer->failed = 1;
+    return -1;
+  }
+  return 0;
+}
+
+int dictlite_writeInt(DictliteWriter * writer, long long value)
+{
+  // Enough for 64 bits plus a sign
+  char digits[24];
+  char * start = digits + sizeof(digits);
+  // Negate as unsigned so the most negative value works
+  unsigned long long magnitude = (value < 0 ?
+				  -(unsigned long long) value :
+				  (unsigned long long) value);
+  do {
+    *--start = (char) ('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude > 0);
+  if (value < 0)
+    *--start = '-';
+  return dictlite_writer_write(writer, start, digits + sizeof(digits) - start);
+}
+
+int dictlite_writeString(DictliteWriter * writer, const char * string, size_t length, DictliteFormat format)
+{
+  static const char hexDigits[] = "0123456789abcdef";
+  int isJson = (format == DICTLITE_FORMAT_JSON);
+  if (isJson && dictlite_writer_write(writer, "\"", 1) != 0)
+    return -1;
+
+  // Write runs of bytes that need no escaping all at once
+  size_t runStart = 0;
+  size_t index;
+  for (index = 0; index < length; ++index) {
+    unsigned char byte = (unsigned char) string[index];
+    char escape[6] = {'\\', 0, 0, 0, 0, 0};
+    size_t escapeLength = 2;
+    switch (byte) {
+    case '\\': escape[1] = '\\'; break;
+    case '\t': escape[1] = 't'; break;
+    case '\n': escape[1] = 'n'; break;
+    case '\r': escape[1] = 'r'; break;
+    default:
+      if (isJson && byte == '"') {
+	escape[1] = '"';
+      } else if (isJson && byte < 0x20) {
+	escape[1] = 'u';
+	escape[2] = '0';
+	escape[3] = '0';
+	escape[4] = hexDigits[byte >> 4];
+	escape[5] = hexDigits[byte & 0xf];
+	escapeLength = 6;
+      } else {
+	continue;
+      }
+    }
+    if (dictlite_writer_write(writer, string + runStart, index - runStart) != 0 ||
+	dictlite_writer_write(writer, escape, escapeLength) != 0)
+      return -1;
+    runStart = index + 1;
+  }
+  if (dictlite_writer_write(writer, string + runStart, length - runStart) != 0)
+    return -1;
+
+  if (isJson && dictlite_writer_write(writer, "\"", 1) != 0)
+    return -1;
+  return 0;
+}
+
+int dictlite_formatString(DictliteWriter * writer, void * string, DictliteFormat format)
+{
+  return dictlite_writeString(writer, (const char *) string, strlen((const char *) string), format);
+}
+
+int dictlite_dump(Dictlite * dict, DictliteWriter * writer,
+		  DictliteFormatter keyFormatter, DictliteFormatter valueFormatter,
+		  DictliteFormat format)
+{
+  int isJson = (format == DICTLITE_FORMAT_JSON);
+  if (isJson && dictlite_writer_write(writer, "{", 1) != 0)
+    return -1;
+
+  // Formatters may look up keys, which must not move items in a cache
+  // out from under the iterator
+  dictlite_lockOrder(dict);
+  DictliteItemIterator iterator = dictlite_itemIterator(dict);
+  MappingItem * item;
+  int isFirst = 1;
+  int rv = 0;
+  while (rv == 0 && (item = dictlite_itemIterator_next(&iterator))) {
+    if ((isJson && !isFirst && dictlite_writer_write(writer, ", ", 2) != 0) ||
+	(keyFormatter)(writer, item->key, format) != 0 ||
+	dictlite_writer_write(writer, (isJson ? ": " : "\t"), (isJson ? 2 : 1)) != 0 ||
+	(valueFormatter)(writer, item->value, format) != 0 ||
+	(!isJson && dictlite_writer_write(writer, "\n", 1) != 0))
+      rv = -1;
+    isFirst = 0;
+  }
+  dictlite_unlockOrder(dict);
+  if (rv != 0)
+    return -1;
+
+  if (isJson && dictlite_writer_write(writer, "}", 1) != 0)
+    return -1;
+  return dictlite_writer_flush(writer);
+}
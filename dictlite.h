@@ -21,12 +21,67 @@ struct dictlite_MappingItem {
 };
 typedef struct dictlite_MappingItem MappingItem;
 
-/* The dictionary data, like a linked list. */
+/* Statistics about how well a filter answers lookups. */
+struct dictlite_FilterStats {
+  size_t lookups;  // Lookups checked against the filter
+  size_t rejections;  // Lookups of absent keys answered by the filter
+  size_t falsePositives;  // Lookups of absent keys that got past the filter
+};
+typedef struct dictlite_FilterStats DictliteFilterStats;
+
+/* A counting Bloom filter over the keys of a dict.  Lookups of absent
+ * keys usually end after a few counter tests instead of a full scan.
+ * Counters allow keys to be removed.  A counter that saturates stays
+ * saturated until the filter is rebuilt, which happens as the dict
+ * grows.
+ */
+struct dictlite_Filter {
+  size_t (* hashKey)(void * key);
+  unsigned char * counters;
+  size_t numCounters;  // Always a power of 2
+  size_t capacity;  // Number of keys before the filter is rebuilt larger
+  DictliteFilterStats stats;
+};
+typedef struct dictlite_Filter DictliteFilter;
+
+/* A node of a radix tree of string keys.  The edge from the parent is
+ * labeled with the bytes the keys below the node share after the
+ * parent's prefix, so shared prefixes are stored once.
+ */
+struct dictlite_RadixNode {
+  char * label;  // Not null terminated
+  size_t labelLength;
+  MappingItem * item;  // Null if no key ends at this node
+  struct dictlite_RadixNode * parent;
+  struct dictlite_RadixNode ** children;  // Sorted by first label byte
+  size_t numChildren;
+  size_t childCapacity;
+};
+typedef struct dictlite_RadixNode RadixNode;
+
+/* Statistics about how well a cache is working. */
+struct dictlite_CacheStats {
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+};
+typedef struct dictlite_CacheStats DictliteCacheStats;
+
+/* The dictionary data, like a linked list.  In a cache the list is kept
+ * in order of recency of use, least recent first.  A radix tree dict
+ * keeps its mappings in the tree instead of the list.
+ */
 struct dictlite_Dictlite {
   MappingItem * head;
   MappingItem * end;
   size_t size;
   int (* compareKeys)(void * key1, void * key2);
+  DictliteFilter * filter;  // Null unless enabled
+  size_t capacity;  // Maximum size of a cache, 0 if not a cache
+  void (* onEvict)(void * key, void * value);
+  DictliteCacheStats cacheStats;
+  int orderLocks;  // While positive, cache lookups do not reorder the list
+  RadixNode * tree;  // Root of a radix tree dict, null otherwise
 };
 typedef struct dictlite_Dictlite Dictlite;
 
@@ -38,6 +93,49 @@ typedef struct dictlite_Dictlite Dictlite;
  */
 Dictlite * dictlite_new(int (* key_comparison_function)(void * key1, void * key2));
 
+/* Create a new dict that acts as a least-recently-used cache holding
+ * at most the given number of mappings.  Adding a mapping to a full
+ * cache evicts the least recently used mapping and passes its key and
+ * value to the eviction function (if not null) so they can be freed.
+ * The eviction function is called after the new mapping is in the dict
+ * (with a null value, if added by dictlite_entry) and the evicted one is
+ * not, but before the adding call returns, so it must not use the dict.
+ * Defer any freeing that could reenter the dict until the call returns.
+ * Getting or setting a value (but not checking whether a key is
+ * present) marks the mapping as most recently used, which is O(1) on
+ * top of the lookup.  If the hash function is not null, a filter is
+ * enabled (see dictlite_enableFilter).  Returns null if the capacity is
+ * 0 or allocation fails.  O(1) plus the filter.
+ */
+Dictlite * dictlite_newCache(int (* key_comparison_function)(void * key1, void * key2),
+			     size_t (* key_hash_function)(void * key),
+			     size_t capacity,
+			     void (* eviction_function)(void * key, void * value));
+
+/* Lock and unlock the order of the mappings.  Lookups in a cache move
+ * the found mapping to the end, so code that looks up keys of a cache
+ * while iterating over it should lock the order during the iteration
+ * or it may never finish.  While locked, lookups still count hits and
+ * misses.  Locks nest.  O(1).
+ */
+void dictlite_lockOrder(Dictlite * dict);
+void dictlite_unlockOrder(Dictlite * dict);
+
+/* Create a new dict for null-terminated string keys that stores its
+ * mappings in a compressed radix tree.  Lookups take time proportional
+ * to the length of the key rather than the size of the dict, keys are
+ * iterated in byte order, and dictlite_prefixIterator visits only the
+ * keys with a given prefix.  The key strings are not copied, so they
+ * must not change while in the dict.  O(1).
+ */
+Dictlite * dictlite_newRadixTree(void);
+
+/* Return the hit, miss, and eviction counts of a cache (all zeros if
+ * the dict is not a cache).  Hits and misses are counted by lookups that
+ * mark mappings as used.  O(1).
+ */
+DictliteCacheStats dictlite_cacheStats(Dictlite * dict);
+
 /* Free a dict.  This does not free the keys or items.  The API user is
  * responsible for doing that (if necessary) prior to freeing the
  * dict.  O(n).
@@ -47,12 +145,30 @@ void dictlite_del(Dictlite * dict);
 /* Return the size of a dict.  O(1). */
 size_t dictlite_size(Dictlite * dict);
 
-/* Return whether the dict contains a key.  O(n). */
+/* Return whether the dict contains a key.  Does not affect the recency
+ * of use in a cache.  O(n).
+ */
 int dictlite_contains(Dictlite * dict, void * key);
 
 /* Gets the value associated with a key.  O(n). */
 void * dictlite_getValue(Dictlite * dict, void * key);
 
+/* Gets the value associated with a key and stores it in *value (if
+ * value is not null).  Returns whether the key is present, which,
+ * unlike dictlite_getValue, distinguishes a missing key from a key
+ * mapped to null.  O(n).
+ */
+int dictlite_tryGet(Dictlite * dict, void * key, void ** value);
+
+/* Returns a pointer to the slot holding the value associated with a
+ * key so that it can be read and written with a single lookup.  Adds
+ * the key with a null value if it is not already present.  Sets
+ * *inserted (if inserted is not null) to whether the key was added.
+ * Returns null if a new mapping could not be allocated.  The pointer is
+ * valid until the mapping is removed.  O(n).
+ */
+void ** dictlite_entry(Dictlite * dict, void * key, int * inserted);
+
 /* Sets the value associated with a key.  Adds the key if it is not
  * already present.  Returns the previous value or null if there was no
  * previous value.  O(n).
@@ -70,23 +186,126 @@ void * dictlite_setValue(Dictlite * dict, void * key, void * item);
 MappingItem * dictlite_delItem(Dictlite * dict, void * key);
 
 /* Adds the mappings in the other dict to this dict.  Updates any
- * existing mappings to those in the other dict.
+ * existing mappings to those in the other dict.  The order of the other
+ * dict is locked while it is iterated, so it may be the same dict.
  */
 void dictlite_addFromDict(Dictlite * dict, Dictlite * otherDict);
 
+/* Negative lookup filter */
+
+/* Enable a filter that lets lookups of absent keys return without
+ * scanning the dict.  The hash function must return equal hashes for
+ * keys that compare equal.  The filter is sized for the given number of
+ * keys (or the current size, if larger) and grows as needed.  Replaces
+ * any existing filter.  Returns 0 on success and -1 if the hash
+ * function is null or the filter could not be allocated.  O(n).
+ */
+int dictlite_enableFilter(Dictlite * dict, size_t (* key_hash_function)(void * key), size_t expectedSize);
+
+/* Disable and free the filter, if any.  O(1). */
+void dictlite_disableFilter(Dictlite * dict);
+
+/* Return the statistics of the filter (all zeros if there is no
+ * filter).  O(1).
+ */
+DictliteFilterStats dictlite_filterStats(Dictlite * dict);
+
+/* Return the fraction of lookups of absent keys that got past the
+ * filter and required a full scan (0 if there have been none).  O(1).
+ */
+double dictlite_filterFalsePositiveRate(Dictlite * dict);
+
+/* Serialization */
+
+/* Formats for dumping a dict */
+typedef enum {
+  DICTLITE_FORMAT_JSON,  // {key: value, key: value}
+  DICTLITE_FORMAT_TSV  // One key<tab>value<newline> line per mapping
+} DictliteFormat;
+
+/* A buffered writer.  Output accumulates in the caller's buffer and is
+ * passed to the flush function (which returns 0 on success) whenever
+ * the buffer fills.  Output too large for the buffer is passed to the
+ * flush function directly.  After a flush fails, all writes fail.
+ */
+struct dictlite_Writer {
+  char * buffer;
+  size_t capacity;
+  size_t length;
+  int (* flush)(void * context, const char * data, size_t length);
+  void * context;
+  int failed;
+};
+typedef struct dictlite_Writer DictliteWriter;
+
+/* Writes a key or value.  Returns 0 on success and -1 on failure. */
+typedef int (* DictliteFormatter)(DictliteWriter * writer, void * object, DictliteFormat format);
+
+/* Return a new writer that buffers output in the given buffer.  The
+ * writer is not dynamically allocated, so do not free it.
+ */
+DictliteWriter dictlite_writer(char * buffer, size_t capacity,
+			       int (* flush_function)(void * context, const char * data, size_t length),
+			       void * context);
+
+/* Writes bytes.  Returns 0 on success and -1 on failure. */
+int dictlite_writer_write(DictliteWriter * writer, const char * data, size_t length);
+
+/* Passes any buffered output to the flush function.  Returns 0 on
+ * success and -1 on failure.
+ */
+int dictlite_writer_flush(DictliteWriter * writer);
+
+/* Writes an integer in decimal.  Returns 0 on success and -1 on
+ * failure.
+ */
+int dictlite_writeInt(DictliteWriter * writer, long long value);
+
+/* Writes a string escaped for the format: quoted with JSON escapes for
+ * JSON and with backslash escapes for tabs, newlines, carriage returns,
+ * and backslashes for TSV.  Bytes 0x80 and above are written as is, so
+ * UTF-8 passes through.  Returns 0 on success and -1 on failure.
+ */
+int dictlite_writeString(DictliteWriter * writer, const char * string, size_t length, DictliteFormat format);
+
+/* Formatter for null-terminated strings */
+int dictlite_formatString(DictliteWriter * writer, void * string, DictliteFormat format);
+
+/* Writes the mappings of a dict in the given format using the
+ * formatters for the keys and values, then flushes the writer.  JSON
+ * requires keys to be strings, so in that format the key formatter
+ * should write strings.  Formatters may look up keys (cache lookups do
+ * not reorder the mappings during a dump) but must not add or remove
+ * mappings.  Returns 0 on success and -1 if the writer or a
+ * formatter fails.  O(n).
+ */
+int dictlite_dump(Dictlite * dict, DictliteWriter * writer,
+		  DictliteFormatter keyFormatter, DictliteFormatter valueFormatter,
+		  DictliteFormat format);
+
 /* Iteration support */
 
 /* Iterator for items ((key, value) pairs) */
 struct dictlite_ItemIterator {
   MappingItem * nextItem;
+  RadixNode * nextNode;  // In a radix tree, the node holding the next item
+  RadixNode * root;  // In a radix tree, the root of the iterated subtree
 };
 typedef struct dictlite_ItemIterator DictliteItemIterator;
 
 /* Return a new iterator.  The iterator is not dynamically allocated, so
- * do not free it.
+ * do not free it.  To look up keys while iterating over a cache, lock
+ * its order (see dictlite_lockOrder).
  */
 DictliteItemIterator dictlite_itemIterator(Dictlite * dict);
 
+/* Return a new iterator over the items whose keys start with the given
+ * prefix.  The dict must be a radix tree dict, otherwise the iterator
+ * is empty.  Only the matching subtree is visited.  O(length of prefix)
+ * to create.
+ */
+DictliteItemIterator dictlite_prefixIterator(Dictlite * dict, const char * prefix);
+
 /* The returned pointers point to live MappingItems in the dictionary.
  * This was done to allow flexibility.  Keys and values may be changed
  * and those changes will be reflected in the dictionary, but be careful
@@ -4,13 +4,20 @@
 // Include Python first as its definitions may affect other headers
 #include <Python.h>
 
+#include <string.h>
+
 #include "dictlite.h"
 
 
+// Size of the buffers for writing dumps
+#define DICTLITEMOD_WRITER_BUFFER_LENGTH 4096
+
 // A Python object wrapper for a Dictlite
 struct dictlitemod_DictliteObject {
   PyObject_HEAD
   Dictlite * dl;
+  // Number of dumps iterating over the dict while calling Python code
+  int dumpsInProgress;
 };
 typedef struct dictlitemod_DictliteObject DictliteObject;
 
@@ -23,13 +30,63 @@ dictlitemod_comparePyObjects(void * obj1, void * obj2)
   return PyObject_Compare(pyObj1, pyObj2);
 }
 
+// (key, value) pairs evicted from caches that are waiting to be released
+static PyObject * dictlitemod_evicted = NULL;
+
+// Takes the key and value of a mapping evicted from a cache.  Releasing
+// them can run arbitrary code (e.g. __del__) that uses the cache, so
+// they are held until the operation that evicted them has finished.
+static void
+dictlitemod_deferEvicted(void * key, void * value)
+{
+  PyObject * pair = PyTuple_Pack(2, (PyObject *) key, (PyObject *) value);
+  if (pair != NULL && dictlitemod_evicted == NULL)
+    dictlitemod_evicted = PyList_New(0);
+  if (pair == NULL || dictlitemod_evicted == NULL ||
+      PyList_Append(dictlitemod_evicted, pair) < 0) {
+    // Out of memory, so release them now and hope for the best
+    PyErr_Clear();
+  }
+  Py_XDECREF(pair);
+  Py_DECREF((PyObject *) key);
+  Py_DECREF((PyObject *) value);
+}
+
+// Releases the evicted keys and values.  Call when done with the dict.
+static void
+dictlitemod_releaseEvicted(void)
+{
+  // Releasing can cause more evictions, which start a new list
+  while (dictlitemod_evicted != NULL) {
+    PyObject * evicted = dictlitemod_evicted;
+    dictlitemod_evicted = NULL;
+    Py_DECREF(evicted);
+  }
+}
+
 static PyObject *
 dictlitemod_new(PyTypeObject * type, PyObject * args, PyObject * kwds)
 {
+  static char * keywords[] = {"capacity", NULL};
+  Py_ssize_t capacity = 0;
+
+  // Parse and check arguments
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|n:Dictlite", keywords, &capacity))
+    return NULL;
+  if (capacity < 0) {
+    PyErr_SetString(PyExc_ValueError, "Capacity must not be negative.");
+    return NULL;
+  }
+
   // Allocate the memory for a new object
   DictliteObject * self = (DictliteObject *) type->tp_alloc(type, 0);
   if (self != NULL) {
-    self->dl = dictlite_new(dictlitemod_comparePyObjects);
+    self->dumpsInProgress = 0;
+    // A positive capacity makes a cache that releases evicted mappings
+    if (capacity > 0)
+      self->dl = dictlite_newCache(dictlitemod_comparePyObjects, NULL, capacity, dictlitemod_deferEvicted);
+    else
+      self->dl = dictlite_new(dictlitemod_comparePyObjects);
   }
 
   return (PyObject *) self;
@@ -84,21 +141,60 @@ dictlitemod_setKeyError(PyObject * key)
 static PyObject *
 dictlitemod_getValue(DictliteObject * self, PyObject * key)
 {
-  PyObject * value = (PyObject *) dictlite_getValue(self->dl, key);
-  if (value == NULL) {
+  void * value;
+  if (!dictlite_tryGet(self->dl, key, &value)) {
     dictlitemod_setKeyError(key);
     return NULL;
   } else {
     // Return the value
     // Must return a new reference
-    Py_INCREF(value);
-    return value;
+    Py_INCREF((PyObject *) value);
+    return (PyObject *) value;
   }
 }
 
+// Dumps iterate over the mappings while calling Python code, which
+// must not add or remove mappings
+static int
+dictlitemod_checkNotDumping(DictliteObject * self)
+{
+  if (self->dumpsInProgress > 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Cannot modify a Dictlite while it is being dumped.");
+    return -1;
+  }
+  return 0;
+}
+
+// Maps the key to the value, taking references to them as needed.
+// Returns -1 on failure.
+static int
+dictlitemod_storeValue(DictliteObject * self, PyObject * key, PyObject * value)
+{
+  // Find or add the mapping with a single lookup
+  int inserted;
+  void ** slot = dictlite_entry(self->dl, key, &inserted);
+  if (slot == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  PyObject * oldValue = (PyObject *) *slot;
+  Py_INCREF(value);
+  *slot = value;
+  if (inserted) {
+    // New mapping was added
+    Py_INCREF(key);
+  } else {
+    // No new mapping, just swapped the old and new values
+    Py_DECREF(oldValue);
+  }
+  return 0;
+}
+
 static int
 dictlitemod_setValue(DictliteObject * self, PyObject * key, PyObject * value)
 {
+  if (dictlitemod_checkNotDumping(self) < 0)
+    return -1;
   // Based on dictobject.c the value can be NULL which means delete the mapping
   // Return -1 on failure
   if (value == NULL) {
@@ -117,18 +213,60 @@ dictlitemod_setValue(DictliteObject * self, PyObject * key, PyObject * value)
       return 0;
     }
   } else {
-    void * oldValue = dictlite_setValue(self->dl, key, value);
-    if (oldValue == NULL) {
-      // New mapping was added (NULL -> no previous mapping)
-      Py_INCREF(key);
-      Py_INCREF(value);
-    } else {
-      // No new mapping, just swapped the old and new values
-      Py_DECREF((PyObject *) oldValue);
-      Py_INCREF(value);
+    int rv = dictlitemod_storeValue(self, key, value);
+    dictlitemod_releaseEvicted();
+    return rv;
+  }
+}
+
+static PyObject *
+dictlitemod_get(DictliteObject * self, PyObject * args)
+{
+  PyObject * key;
+  PyObject * defaultValue = Py_None;
+  void * value;
+
+  if (!PyArg_UnpackTuple(args, "get", 1, 2, &key, &defaultValue))
+    return NULL;
+  if (!dictlite_tryGet(self->dl, key, &value))
+    value = defaultValue;
+  Py_INCREF((PyObject *) value);
+  return (PyObject *) value;
+}
+
+static PyObject *
+dictlitemod_setdefault(DictliteObject * self, PyObject * args)
+{
+  PyObject * key;
+  PyObject * defaultValue = Py_None;
+  int inserted;
+  void ** slot;
+
+  if (!PyArg_UnpackTuple(args, "setdefault", 1, 2, &key, &defaultValue))
+    return NULL;
+  if (self->dumpsInProgress > 0) {
+    // Only a read is allowed during a dump
+    void * existing;
+    if (dictlite_tryGet(self->dl, key, &existing)) {
+      Py_INCREF((PyObject *) existing);
+      return (PyObject *) existing;
     }
-    return 0;
+    dictlitemod_checkNotDumping(self);
+    return NULL;
+  }
+  slot = dictlite_entry(self->dl, key, &inserted);
+  if (slot == NULL)
+    return PyErr_NoMemory();
+  if (inserted) {
+    // New mapping was added, fill in its value
+    Py_INCREF(key);
+    Py_INCREF(defaultValue);
+    *slot = defaultValue;
   }
+  PyObject * value = (PyObject *) *slot;
+  Py_INCREF(value);
+  dictlitemod_releaseEvicted();
+  return value;
 }
 
 static Dictlite *
@@ -192,6 +330,8 @@ dictlitemod_addFromDict(DictliteObject * self, PyObject * args)
   Dictlite * otherDict = NULL;
 
   // Parse and check arguments
+  if (dictlitemod_checkNotDumping(self) < 0)
+    goto finally;
   if (!PyArg_ParseTuple(args, "O:addFromDict", &otherDictObj))
     goto finally;
   Py_INCREF(otherDictObj);  // Own otherDictObj
@@ -205,8 +345,15 @@ dictlitemod_addFromDict(DictliteObject * self, PyObject * args)
   if (otherDict == NULL)
     goto finally;
 
-  // Add the mappings from the created other dict to self
-  dictlite_addFromDict(self->dl, otherDict);
+  // Add the mappings from the created other dict to self.  Self takes
+  // its own references because the other dict releases its references
+  // when it is cleaned up.
+  DictliteItemIterator iterator = dictlite_itemIterator(otherDict);
+  MappingItem * item;
+  while ((item = dictlite_itemIterator_next(&iterator))) {
+    if (dictlitemod_storeValue(self, (PyObject *) item->key, (PyObject *) item->value) < 0)
+      goto finally;
+  }
   errorOccurred = 0;
 
  finally:
@@ -217,12 +364,204 @@ dictlitemod_addFromDict(DictliteObject * self, PyObject * args)
   }
   // Clean up Python objects
   Py_XDECREF(otherDictObj);
+  dictlitemod_releaseEvicted();
   // Return error or None
   if (errorOccurred)
     return NULL;
   Py_RETURN_NONE;
 }
 
+static PyObject *
+dictlitemod_cacheStats(DictliteObject * self)
+{
+  DictliteCacheStats stats = dictlite_cacheStats(self->dl);
+  return Py_BuildValue("{s:n,s:n,s:n}",
+		       "hits", (Py_ssize_t) stats.hits,
+		       "misses", (Py_ssize_t) stats.misses,
+		       "evictions", (Py_ssize_t) stats.evictions);
+}
+
+// Writes a Python string object's bytes
+static int
+dictlitemod_writePyString(DictliteWriter * writer, PyObject * string, DictliteFormat format, int escape)
+{
+  if (string == NULL)
+    return -1;
+  int rv = (escape ?
+	    dictlite_writeString(writer, PyString_AS_STRING(string), PyString_GET_SIZE(string), format) :
+	    dictlite_writer_write(writer, PyString_AS_STRING(string), PyString_GET_SIZE(string)));
+  Py_DECREF(string);
+  return rv;
+}
+
+// Formatter that writes the repr of an object
+static int
+dictlitemod_formatRepr(DictliteWriter * writer, void * object, DictliteFormat format)
+{
+  return dictlitemod_writePyString(writer, PyObject_Repr((PyObject *) object), format, 0);
+}
+
+// Formatter that writes an object as a string, with fast paths for
+// strings and integers
+static int
+dictlitemod_formatString(DictliteWriter * writer, void * object, DictliteFormat format)
+{
+  PyObject * obj = (PyObject *) object;
+  if (PyString_Check(obj))
+    return dictlite_writeString(writer, PyString_AS_STRING(obj), PyString_GET_SIZE(obj), format);
+  if (PyUnicode_Check(obj))
+    return dictlitemod_writePyString(writer, PyUnicode_AsUTF8String(obj), format, 1);
+  if (PyInt_CheckExact(obj)) {
+    // Quote integers in JSON to make them strings
+    int isJson = (format == DICTLITE_FORMAT_JSON);
+    if ((isJson && dictlite_writer_write(writer, "\"", 1) != 0) ||
+	dictlite_writeInt(writer, PyInt_AS_LONG(obj)) != 0 ||
+	(isJson && dictlite_writer_write(writer, "\"", 1) != 0))
+      return -1;
+    return 0;
+  }
+  return dictlitemod_writePyString(writer, PyObject_Str(obj), format, 1);
+}
+
+// Formatter that writes an object as a value, which in JSON need not
+// be a string
+static int
+dictlitemod_formatValue(DictliteWriter * writer, void * object, DictliteFormat format)
+{
+  PyObject * obj = (PyObject *) object;
+  if (format == DICTLITE_FORMAT_JSON) {
+    if (obj == Py_None)
+      return dictlite_writer_write(writer, "null", 4);
+    if (PyBool_Check(obj))
+      return (obj == Py_True ?
+	      dictlite_writer_write(writer, "true", 4) :
+	      dictlite_writer_write(writer, "false", 5));
+    if (PyInt_Check(obj))
+      return dictlite_writeInt(writer, PyInt_AS_LONG(obj));
+    // The str of a long has no 'L' suffix and the repr of a float has
+    // full precision
+    if (PyLong_Check(obj))
+      return dictlitemod_writePyString(writer, PyObject_Str(obj), format, 0);
+    if (PyFloat_Check(obj)) {
+      // JSON has no NaN or infinity
+      if (!Py_IS_FINITE(PyFloat_AS_DOUBLE(obj)))
+	return dictlite_writer_write(writer, "null", 4);
+      return dictlitemod_writePyString(writer, PyObject_Repr(obj), format, 0);
+    }
+  }
+  return dictlitemod_formatString(writer, object, format);
+}
+
+// A growable in-memory destination for a writer
+struct dictlitemod_StringSink {
+  char * data;
+  size_t length;
+  size_t capacity;
+};
+typedef struct dictlitemod_StringSink StringSink;
+
+static int
+dictlitemod_appendToSink(void * context, const char * data, size_t length)
+{
+  StringSink * sink = (StringSink *) context;
+  if (length > sink->capacity - sink->length) {
+    size_t capacity = (sink->capacity > 0 ? sink->capacity : 256);
+    while (length > capacity - sink->length)
+      capacity *= 2;
+    char * grown = (char *) PyMem_Realloc(sink->data, capacity);
+    if (grown == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+    sink->data = grown;
+    sink->capacity = capacity;
+  }
+  memcpy(sink->data + sink->length, data, length);
+  sink->length += length;
+  return 0;
+}
+
+// Passes output to the write method of a Python file-like object
+static int
+dictlitemod_writeToFile(void * context, const char * data, size_t length)
+{
+  PyObject * string = PyString_FromStringAndSize(data, length);
+  if (string == NULL)
+    return -1;
+  PyObject * result = PyObject_CallMethod((PyObject *) context, "write", "(O)", string);
+  Py_DECREF(string);
+  if (result == NULL)
+    return -1;
+  Py_DECREF(result);
+  return 0;
+}
+
+// Dumps the dict while preventing changes to it
+static int
+dictlitemod_dumpTo(DictliteObject * self, DictliteWriter * writer,
+		   DictliteFormatter keyFormatter, DictliteFormatter valueFormatter,
+		   DictliteFormat format)
+{
+  ++(self->dumpsInProgress);
+  int rv = dictlite_dump(self->dl, writer, keyFormatter, valueFormatter, format);
+  --(self->dumpsInProgress);
+  return rv;
+}
+
+static PyObject *
+dictlitemod_repr(DictliteObject * self)
+{
+  // Handle recursive containers (based on dictobject.c)
+  int status = Py_ReprEnter((PyObject *) self);
+  if (status != 0)
+    return (status > 0 ? PyString_FromString("Dictlite({...})") : NULL);
+
+  PyObject * repr = NULL;
+  char buffer[DICTLITEMOD_WRITER_BUFFER_LENGTH];
+  StringSink sink = {NULL, 0, 0};
+  DictliteWriter writer = dictlite_writer(buffer, sizeof(buffer), dictlitemod_appendToSink, &sink);
+  // Python's dict repr has the same form as JSON
+  if (dictlite_writer_write(&writer, "Dictlite(", 9) == 0 &&
+      dictlitemod_dumpTo(self, &writer, dictlitemod_formatRepr, dictlitemod_formatRepr, DICTLITE_FORMAT_JSON) == 0 &&
+      dictlite_writer_write(&writer, ")", 1) == 0 &&
+      dictlite_writer_flush(&writer) == 0)
+    repr = PyString_FromStringAndSize(sink.data, sink.length);
+
+  PyMem_Free(sink.data);
+  Py_ReprLeave((PyObject *) self);
+  return repr;
+}
+
+static PyObject *
+dictlitemod_dump(DictliteObject * self, PyObject * args, PyObject * kwds)
+{
+  static char * keywords[] = {"file", "format", NULL};
+  PyObject * file = NULL;
+  const char * formatName = "json";
+  DictliteFormat format;
+
+  // Parse and check arguments
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|s:dump", keywords, &file, &formatName))
+    return NULL;
+  if (strcmp(formatName, "json") == 0) {
+    format = DICTLITE_FORMAT_JSON;
+  } else if (strcmp(formatName, "tsv") == 0) {
+    format = DICTLITE_FORMAT_TSV;
+  } else {
+    PyErr_Format(PyExc_ValueError, "Expected 'json' or 'tsv' not '%s'.", formatName);
+    return NULL;
+  }
+
+  char buffer[DICTLITEMOD_WRITER_BUFFER_LENGTH];
+  DictliteWriter writer = dictlite_writer(buffer, sizeof(buffer), dictlitemod_writeToFile, file);
+  if (dictlitemod_dumpTo(self, &writer, dictlitemod_formatString, dictlitemod_formatValue, format) != 0) {
+    if (!PyErr_Occurred())
+      PyErr_SetString(PyExc_IOError, "Failed to dump Dictlite.");
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
 // Python sequence methods for Dictlite
 static PySequenceMethods dictlitemod_as_sequence = {
   (lenfunc) dictlitemod_size,  // sq_length
@@ -244,6 +583,10 @@ static PyMappingMethods dictlitemod_as_mapping = {
 // Methods of the Dictlite type
 static PyMethodDef dictlitemod_methods[] = {
   {"addFromDict", (PyCFunction) dictlitemod_addFromDict, METH_VARARGS, "Adds the mappings contained in the given dict to this dict."},
+  {"get", (PyCFunction) dictlitemod_get, METH_VARARGS, "D.get(k[,d]) -> D[k] if k in D, else d.  d defaults to None."},
+  {"setdefault", (PyCFunction) dictlitemod_setdefault, METH_VARARGS, "D.setdefault(k[,d]) -> D.get(k,d), also set D[k]=d if k not in D."},
+  {"cacheStats", (PyCFunction) dictlitemod_cacheStats, METH_NOARGS, "Returns the hit, miss, and eviction counts of a cache as a dict."},
+  {"dump", (PyCFunction) dictlitemod_dump, METH_VARARGS | METH_KEYWORDS, "dump(file, format='json')\n\nWrites the mappings to a file-like object as JSON (keys as strings) or as TSV lines of key<tab>value.  In JSON, NaN and infinite float values are written as null."},
   {NULL, NULL, 0, NULL}  // Sentinel
 };
 
@@ -259,7 +602,7 @@ static PyTypeObject dictlitemod_type = {
   0,  // tp_getattr
   0,  // tp_setattr
   0,  // tp_compare
-  0,  // tp_repr
+  (reprfunc) dictlitemod_repr,  // tp_repr
   0,  // tp_as_number
   &dictlitemod_as_sequence,  // tp_as_sequence
   &dictlitemod_as_mapping,  // tp_as_mapping
@@ -270,7 +613,7 @@ static PyTypeObject dictlitemod_type = {
   0,  // tp_setattro
   0,  // tp_as_buffer
   Py_TPFLAGS_DEFAULT,  // tp_flags
-  "Lightweight dictionary object",  // tp_doc
+  "Dictlite(capacity=0)\n\nLightweight dictionary object.  A positive capacity makes a least-recently-used cache holding at most that many mappings.",  // tp_doc
   0,  // tp_traverse
   0,  // tp_clear
   0,  // tp_richcompare
@@ -290,6 +633,497 @@ static PyTypeObject dictlitemod_type = {
   dictlitemod_new,  // tp_new
 };
 
+////////////////////////////////////////
+// TypedDictlite
+////////////////////////////////////////
+
+// Native types for the keys and values of a typed dict
+typedef enum {
+  DICTLITEMOD_INT64,
+  DICTLITEMOD_FLOAT64
+} dictlitemod_ScalarType;
+
+// A native 64-bit key or value
+typedef union {
+  PY_LONG_LONG i;
+  double f;
+} dictlitemod_Scalar;
+
+// Storage for a typed mapping.  The key comes first so that the dict's
+// key pointer is also the pointer to free.
+struct dictlitemod_TypedMapping {
+  dictlitemod_Scalar key;
+  dictlitemod_Scalar value;
+};
+typedef struct dictlitemod_TypedMapping TypedMapping;
+
+// A Python object wrapper for a Dictlite with native keys and values
+struct dictlitemod_TypedDictliteObject {
+  PyObject_HEAD
+  Dictlite * dl;
+  dictlitemod_ScalarType keyType;
+  dictlitemod_ScalarType valueType;
+  // Number of batch lookups running without the GIL
+  int batchesInProgress;
+  // Storage for the next new mapping
+  TypedMapping * spare;
+};
+typedef struct dictlitemod_TypedDictliteObject TypedDictliteObject;
+
+static int
+dictlitemod_compareInt64s(void * key1, void * key2)
+{
+  PY_LONG_LONG int1 = ((dictlitemod_Scalar *) key1)->i;
+  PY_LONG_LONG int2 = ((dictlitemod_Scalar *) key2)->i;
+  return (int1 > int2) - (int1 < int2);
+}
+
+static int
+dictlitemod_compareFloat64s(void * key1, void * key2)
+{
+  double float1 = ((dictlitemod_Scalar *) key1)->f;
+  double float2 = ((dictlitemod_Scalar *) key2)->f;
+  // NaN keys are rejected on conversion since they would never be equal
+  if (float1 == float2)
+    return 0;
+  return (float1 < float2 ? -1 : 1);
+}
+
+static int
+dictlitemod_parseScalarType(const char * name, dictlitemod_ScalarType * type)
+{
+  if (strcmp(name, "int64") == 0) {
+    *type = DICTLITEMOD_INT64;
+  } else if (strcmp(name, "float64") == 0) {
+    *type = DICTLITEMOD_FLOAT64;
+  } else {
+    PyErr_Format(PyExc_ValueError, "Expected 'int64' or 'float64' not '%s'.", name);
+    return -1;
+  }
+  return 0;
+}
+
+// Converts a Python number to a native scalar.  Returns -1 on failure.
+static int
+dictlitemod_scalarFromPyObject(PyObject * obj, dictlitemod_ScalarType type, dictlitemod_Scalar * scalar)
+{
+  if (type == DICTLITEMOD_INT64) {
+    // Only accept integers (not floats, which would be truncated)
+    if (!PyIndex_Check(obj)) {
+      PyErr_Format(PyExc_TypeError, "Expected an integer not a '%s'.", obj->ob_type->tp_name);
+      return -1;
+    }
+    PyObject * index = PyNumber_Index(obj);
+    if (index == NULL)
+      return -1;
+    scalar->i = PyLong_AsLongLong(index);
+    Py_DECREF(index);
+    if (scalar->i == -1 && PyErr_Occurred())
+      return -1;
+  } else {
+    scalar->f = PyFloat_AsDouble(obj);
+    if (scalar->f == -1.0 && PyErr_Occurred())
+      return -1;
+  }
+  return 0;
+}
+
+// Converts a Python number to a native key.  Rejects NaN, which could
+// be stored but never found again.  Returns -1 on failure.
+static int
+dictlitemod_keyFromPyObject(PyObject * obj, dictlitemod_ScalarType type, dictlitemod_Scalar * key)
+{
+  if (dictlitemod_scalarFromPyObject(obj, type, key) < 0)
+    return -1;
+  if (type == DICTLITEMOD_FLOAT64 && Py_IS_NAN(key->f)) {
+    PyErr_SetString(PyExc_ValueError, "NaN cannot be a key.");
+    return -1;
+  }
+  return 0;
+}
+
+static PyObject *
+dictlitemod_scalarToPyObject(dictlitemod_Scalar scalar, dictlitemod_ScalarType type)
+{
+  if (type == DICTLITEMOD_INT64) {
+    if (scalar.i >= LONG_MIN && scalar.i <= LONG_MAX)
+      return PyInt_FromLong((long) scalar.i);
+    return PyLong_FromLongLong(scalar.i);
+  } else {
+    return PyFloat_FromDouble(scalar.f);
+  }
+}
+
+static PyObject *
+dictlitemod_typed_new(PyTypeObject * type, PyObject * args, PyObject * kwds)
+{
+  static char * keywords[] = {"keyType", "valueType", NULL};
+  const char * keyTypeName = "int64";
+  const char * valueTypeName = "int64";
+  dictlitemod_ScalarType keyType;
+  dictlitemod_ScalarType valueType;
+
+  // Parse and check arguments
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ss:TypedDictlite", keywords, &keyTypeName, &valueTypeName))
+    return NULL;
+  if (dictlitemod_parseScalarType(keyTypeName, &keyType) < 0 ||
+      dictlitemod_parseScalarType(valueTypeName, &valueType) < 0)
+    return NULL;
+
+  // Allocate the memory for a new object
+  TypedDictliteObject * self = (TypedDictliteObject *) type->tp_alloc(type, 0);
+  if (self == NULL)
+    return NULL;
+  self->keyType = keyType;
+  self->valueType = valueType;
+  self->batchesInProgress = 0;
+  self->spare = NULL;
+  self->dl = dictlite_new(keyType == DICTLITEMOD_INT64 ?
+			  dictlitemod_compareInt64s :
+			  dictlitemod_compareFloat64s);
+  if (self->dl == NULL) {
+    Py_DECREF(self);
+    return PyErr_NoMemory();
+  }
+  return (PyObject *) self;
+}
+
+static void
+dictlitemod_typed_del(TypedDictliteObject * self)
+{
+  if (self->dl) {
+    // Free the mappings through their keys
+    DictliteItemIterator iterator = dictlite_itemIterator(self->dl);
+    MappingItem * item;
+    while ((item = dictlite_itemIterator_next(&iterator))) {
+      free(item->key);
+    }
+    dictlite_del(self->dl);
+  }
+  free(self->spare);
+  self->ob_type->tp_free((PyObject *) self);
+}
+
+static Py_ssize_t
+dictlitemod_typed_size(TypedDictliteObject * self)
+{
+  return dictlite_size(self->dl);
+}
+
+static int
+dictlitemod_typed_contains(TypedDictliteObject * self, PyObject * key)
+{
+  dictlitemod_Scalar nativeKey;
+  if (dictlitemod_keyFromPyObject(key, self->keyType, &nativeKey) < 0)
+    return -1;
+  return dictlite_contains(self->dl, &nativeKey);
+}
+
+static PyObject *
+dictlitemod_typed_getValue(TypedDictliteObject * self, PyObject * key)
+{
+  dictlitemod_Scalar nativeKey;
+  if (dictlitemod_keyFromPyObject(key, self->keyType, &nativeKey) < 0)
+    return NULL;
+  dictlitemod_Scalar * value = (dictlitemod_Scalar *) dictlite_getValue(self->dl, &nativeKey);
+  if (value == NULL) {
+    dictlitemod_setKeyError(key);
+    return NULL;
+  }
+  return dictlitemod_scalarToPyObject(*value, self->valueType);
+}
+
+static int
+dictlitemod_typed_setValue(TypedDictliteObject * self, PyObject * key, PyObject * value)
+{
+  // Batch lookups traverse the dict without the GIL so it must not change under them
+  if (self->batchesInProgress > 0) {
+    PyErr_SetString(PyExc_RuntimeError, "Cannot modify a TypedDictlite during a batch lookup.");
+    return -1;
+  }
+
+  dictlitemod_Scalar nativeKey;
+  if (dictlitemod_keyFromPyObject(key, self->keyType, &nativeKey) < 0)
+    return -1;
+
+  // A NULL value means delete the mapping
+  if (value == NULL) {
+    MappingItem * item = dictlite_delItem(self->dl, &nativeKey);
+    if (item == NULL) {
+      dictlitemod_setKeyError(key);
+      return -1;
+    }
+    free(item->key);
+    free(item);
+    return 0;
+  }
+
+  dictlitemod_Scalar nativeValue;
+  if (dictlitemod_scalarFromPyObject(value, self->valueType, &nativeValue) < 0)
+    return -1;
+  // Keep a mapping ready so that a new key can be inserted with its
+  // final storage in a single lookup
+  if (self->spare == NULL) {
+    self->spare = (TypedMapping *) malloc(sizeof(TypedMapping));
+    if (self->spare == NULL) {
+      PyErr_NoMemory();
+      return -1;
+    }
+  }
+  self->spare->key = nativeKey;
+  int inserted;
+  void ** slot = dictlite_entry(self->dl, &self->spare->key, &inserted);
+  if (slot == NULL) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  if (inserted) {
+    // The spare mapping now belongs to the dict
+    *slot = &self->spare->value;
+    self->spare = NULL;
+  }
+  *((dictlitemod_Scalar *) *slot) = nativeValue;
+  return 0;
+}
+
+// Checks that a buffer holds items of the given size in one of the
+// given native formats.  Returns -1 on failure.
+static int
+dictlitemod_checkBuffer(Py_buffer * buffer, const char * formats, Py_ssize_t itemSize, const char * name)
+{
+  const char * format = (buffer->format != NULL ? buffer->format : "B");
+  // Skip a byte order prefix that matches the native byte order
+#ifdef WORDS_BIGENDIAN
+  if (*format == '@' || *format == '=' || *format == '>' || *format == '!')
+    ++format;
+#else
+  if (*format == '@' || *format == '=' || *format == '<')
+    ++format;
+#endif
+  if (buffer->itemsize != itemSize || format[0] == '\0' || format[1] != '\0' ||
+      strchr(formats, format[0]) == NULL) {
+    PyErr_Format(PyExc_TypeError, "Buffer '%s' has unsupported format '%s'.", name,
+		 (buffer->format != NULL ? buffer->format : "B"));
+    return -1;
+  }
+  return 0;
+}
+
+static const char *
+dictlitemod_scalarFormats(dictlitemod_ScalarType type)
+{
+  // Numpy exports int64 as 'l' where longs are 64 bits
+  if (type == DICTLITEMOD_INT64)
+    return (sizeof(long) == sizeof(PY_LONG_LONG) ? "ql" : "q");
+  return "d";
+}
+
+// Looks up the keys in a native array and copies the values (or the
+// default) to a native array.  Does not touch any Python objects.
+// Returns the number of keys found.
+static Py_ssize_t
+dictlitemod_getMany(Dictlite * dict, const char * keys, char * values, Py_ssize_t count, dictlitemod_Scalar defaultValue)
+{
+  Py_ssize_t numFound = 0;
+  Py_ssize_t index;
+  dictlitemod_Scalar key;
+  dictlitemod_Scalar * value;
+  for (index = 0; index < count; ++index) {
+    // Copy to handle unaligned buffers
+    memcpy(&key, keys + index * sizeof(key), sizeof(key));
+    value = (dictlitemod_Scalar *) dictlite_getValue(dict, &key);
+    if (value != NULL) {
+      ++numFound;
+      memcpy(values + index * sizeof(key), value, sizeof(key));
+    } else {
+      memcpy(values + index * sizeof(key), &defaultValue, sizeof(key));
+    }
+  }
+  return numFound;
+}
+
+// Looks up the keys in a native array and sets the corresponding bytes
+// to 1 if present and 0 if not.  Does not touch any Python objects.
+// Returns the number of keys found.
+static Py_ssize_t
+dictlitemod_containsMany(Dictlite * dict, const char * keys, char * flags, Py_ssize_t count)
+{
+  Py_ssize_t numFound = 0;
+  Py_ssize_t index;
+  dictlitemod_Scalar key;
+  for (index = 0; index < count; ++index) {
+    memcpy(&key, keys + index * sizeof(key), sizeof(key));
+    flags[index] = (char) dictlite_contains(dict, &key);
+    numFound += flags[index];
+  }
+  return numFound;
+}
+
+// Gets the key and output buffers for a batch lookup.  Returns the
+// number of keys or -1 on failure, in which case no buffers are held.
+static Py_ssize_t
+dictlitemod_getBatchBuffers(TypedDictliteObject * self, PyObject * keysObj, PyObject * outObj,
+			    Py_buffer * keys, Py_buffer * out, const char * outFormats, Py_ssize_t outItemSize)
+{
+  if (PyObject_GetBuffer(keysObj, keys, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+    return -1;
+  if (PyObject_GetBuffer(outObj, out, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE) < 0) {
+    PyBuffer_Release(keys);
+    return -1;
+  }
+  if (dictlitemod_checkBuffer(keys, dictlitemod_scalarFormats(self->keyType), sizeof(dictlitemod_Scalar), "keys") < 0 ||
+      dictlitemod_checkBuffer(out, outFormats, outItemSize, "out") < 0)
+    goto error;
+  Py_ssize_t count = keys->len / keys->itemsize;
+  if (out->len / out->itemsize != count) {
+    PyErr_Format(PyExc_ValueError, "Expected %zd output items not %zd.", count, out->len / out->itemsize);
+    goto error;
+  }
+  return count;
+
+ error:
+  PyBuffer_Release(out);
+  PyBuffer_Release(keys);
+  return -1;
+}
+
+static PyObject *
+dictlitemod_typed_getMany(TypedDictliteObject * self, PyObject * args)
+{
+  PyObject * keysObj = NULL;
+  PyObject * outObj = NULL;
+  PyObject * defaultObj = NULL;
+  Py_buffer keys;
+  Py_buffer out;
+  dictlitemod_Scalar defaultValue;
+  Py_ssize_t count;
+  Py_ssize_t numFound;
+
+  // Parse and check arguments
+  if (!PyArg_ParseTuple(args, "OO|O:get_many", &keysObj, &outObj, &defaultObj))
+    return NULL;
+  if (defaultObj != NULL) {
+    if (dictlitemod_scalarFromPyObject(defaultObj, self->valueType, &defaultValue) < 0)
+      return NULL;
+  } else if (self->valueType == DICTLITEMOD_INT64) {
+    defaultValue.i = 0;
+  } else {
+    defaultValue.f = 0.0;
+  }
+  count = dictlitemod_getBatchBuffers(self, keysObj, outObj, &keys, &out,
+				      dictlitemod_scalarFormats(self->valueType), sizeof(dictlitemod_Scalar));
+  if (count < 0)
+    return NULL;
+
+  // Do the lookups without the GIL
+  ++(self->batchesInProgress);
+  Py_BEGIN_ALLOW_THREADS
+  numFound = dictlitemod_getMany(self->dl, keys.buf, out.buf, count, defaultValue);
+  Py_END_ALLOW_THREADS
+  --(self->batchesInProgress);
+
+  PyBuffer_Release(&out);
+  PyBuffer_Release(&keys);
+  return PyInt_FromSsize_t(numFound);
+}
+
+static PyObject *
+dictlitemod_typed_containsMany(TypedDictliteObject * self, PyObject * args)
+{
+  PyObject * keysObj = NULL;
+  PyObject * outObj = NULL;
+  Py_buffer keys;
+  Py_buffer out;
+  Py_ssize_t count;
+  Py_ssize_t numFound;
+
+  // Parse and check arguments
+  if (!PyArg_ParseTuple(args, "OO:contains_many", &keysObj, &outObj))
+    return NULL;
+  count = dictlitemod_getBatchBuffers(self, keysObj, outObj, &keys, &out, "?bB", 1);
+  if (count < 0)
+    return NULL;
+
+  // Do the lookups without the GIL
+  ++(self->batchesInProgress);
+  Py_BEGIN_ALLOW_THREADS
+  numFound = dictlitemod_containsMany(self->dl, keys.buf, out.buf, count);
+  Py_END_ALLOW_THREADS
+  --(self->batchesInProgress);
+
+  PyBuffer_Release(&out);
+  PyBuffer_Release(&keys);
+  return PyInt_FromSsize_t(numFound);
+}
+
+// Python sequence methods for TypedDictlite
+static PySequenceMethods dictlitemod_typed_as_sequence = {
+  (lenfunc) dictlitemod_typed_size,  // sq_length
+  0,  // sq_concat
+  0,  // sq_repeat
+  0,  // sq_item
+  0,  // sq_slice
+  0,  // sq_ass_item
+  0,  // sq_ass_slice
+  (objobjproc) dictlitemod_typed_contains,  // sq_contains
+};
+
+static PyMappingMethods dictlitemod_typed_as_mapping = {
+  (lenfunc) dictlitemod_typed_size,  // mp_length
+  (binaryfunc) dictlitemod_typed_getValue,  // mp_subscript
+  (objobjargproc) dictlitemod_typed_setValue,  // mp_ass_subscript
+};
+
+// Methods of the TypedDictlite type
+static PyMethodDef dictlitemod_typed_methods[] = {
+  {"get_many", (PyCFunction) dictlitemod_typed_getMany, METH_VARARGS, "get_many(keys, out[, default]) -> number found\n\nLooks up each key in the buffer 'keys' and stores its value (or 'default', which is 0 if not given) in the corresponding item of the writable buffer 'out'.  Releases the GIL during the lookups."},
+  {"contains_many", (PyCFunction) dictlitemod_typed_containsMany, METH_VARARGS, "contains_many(keys, out) -> number found\n\nSets each byte of the writable buffer 'out' to 1 if the corresponding key in the buffer 'keys' is present and 0 if not.  Releases the GIL during the lookups."},
+  {NULL, NULL, 0, NULL}  // Sentinel
+};
+
+// The Python TypedDictlite type
+static PyTypeObject dictlitemod_typed_type = {
+  PyObject_HEAD_INIT(&PyType_Type)
+  0,  // ob_size
+  "dictlite.TypedDictlite",  // tp_name
+  sizeof(TypedDictliteObject),  // tp_basicsize
+  0,  // tp_itemsize
+  (destructor) dictlitemod_typed_del,  // tp_dealloc
+  0,  // tp_print
+  0,  // tp_getattr
+  0,  // tp_setattr
+  0,  // tp_compare
+  0,  // tp_repr
+  0,  // tp_as_number
+  &dictlitemod_typed_as_sequence,  // tp_as_sequence
+  &dictlitemod_typed_as_mapping,  // tp_as_mapping
+  0,  // tp_hash
+  0,  // tp_call
+  0,  // tp_str
+  0,  // tp_getattro
+  0,  // tp_setattro
+  0,  // tp_as_buffer
+  Py_TPFLAGS_DEFAULT,  // tp_flags
+  "TypedDictlite(keyType='int64', valueType='int64')\n\nLightweight dictionary with native 64-bit keys and values ('int64' or 'float64')",  // tp_doc
+  0,  // tp_traverse
+  0,  // tp_clear
+  0,  // tp_richcompare
+  0,  // tp_weaklistoffset
+  0,  // tp_iter
+  0,  // tp_iternext
+  dictlitemod_typed_methods,  // tp_methods
+  0,  // tp_members
+  0,  // tp_getset
+  0,  // tp_base
+  0,  // tp_dict
+  0,  // tp_descr_get
+  0,  // tp_descr_set
+  0,  // tp_dictoffset
+  0,  // tp_init
+  0,  // tp_alloc
+  dictlitemod_typed_new,  // tp_new
+};
+
 // Module methods
 static PyMethodDef dictlitemod_module_methods[] = {
   {NULL}
@@ -301,6 +1135,8 @@ initdictlite()
 {
   if (PyType_Ready(&dictlitemod_type) < 0)
     return;
+  if (PyType_Ready(&dictlitemod_typed_type) < 0)
+    return;
 
   PyObject * module = Py_InitModule3("dictlite", dictlitemod_module_methods, "Lightweight dictionary object module.");
   if (module == NULL)
@@ -308,4 +1144,6 @@ initdictlite()
 
   Py_INCREF(&dictlitemod_type);
   PyModule_AddObject(module, "Dictlite", (PyObject *) &dictlitemod_type);
+  Py_INCREF(&dictlitemod_typed_type);
+  PyModule_AddObject(module, "TypedDictlite", (PyObject *) &dictlitemod_typed_type);
 }
@@ -6,51 +6,57 @@
 
 #include "dictlite.h"
 
-#define STRING_BUFFER_LENGTH 256
-static char keyStringBuffer[STRING_BUFFER_LENGTH];
-static char valueStringBuffer[STRING_BUFFER_LENGTH];
-static const char * const defaultString = "<unknown-type>";
-
-typedef enum {
-  STRING,
-  BOXINT
-} Types;
+#define OUTPUT_BUFFER_LENGTH 4096
 
 struct Boxint {
   int value;
 };
 
-static void object_to_string(void * object, Types typeCode, char * stringBuffer, size_t stringBufferLength)
+static int format_boxint_key(DictliteWriter * writer, void * object, DictliteFormat format)
 {
-  int numBytes;
-  switch (typeCode) {
-  case STRING:
-    numBytes = snprintf(stringBuffer, stringBufferLength, "\"%s\"", (char *) object);
-    break;
-  case BOXINT:
-    numBytes = snprintf(stringBuffer, stringBufferLength, "%d", ((struct Boxint *) object)->value);
-    break;
-  default:
-    numBytes = snprintf(stringBuffer, stringBufferLength, defaultString);
-    break;
-  }
-  if (numBytes < 0)
-    printf("Error in snprintf.\n");
-  else if (numBytes >= stringBufferLength)
-    stringBuffer[stringBufferLength - 1] = '\0';
+  // JSON keys must be strings
+  int isJson = (format == DICTLITE_FORMAT_JSON);
+  if (isJson && dictlite_writer_write(writer, "\"", 1) != 0)
+    return -1;
+  if (dictlite_writeInt(writer, ((struct Boxint *) object)->value) != 0)
+    return -1;
+  if (isJson && dictlite_writer_write(writer, "\"", 1) != 0)
+    return -1;
+  return 0;
+}
+
+static int write_to_stdout(void * context, const char * data, size_t length)
+{
+  return (fwrite(data, 1, length, stdout) == length ? 0 : -1);
+}
+
+static void dictlite_print(Dictlite * dict, DictliteFormatter keyFormatter, DictliteFormatter valueFormatter)
+{
+  char outputBuffer[OUTPUT_BUFFER_LENGTH];
+  DictliteWriter writer = dictlite_writer(outputBuffer, OUTPUT_BUFFER_LENGTH, write_to_stdout, NULL);
+  printf("dictlite[%zd] ", dictlite_size(dict));
+  if (dictlite_dump(dict, &writer, keyFormatter, valueFormatter, DICTLITE_FORMAT_JSON) != 0)
+    printf("Error writing dict.");
+  printf("\n");
 }
 
-static void dictlite_print(Dictlite * dict, Types keyTypeCode, Types valueTypeCode)
+static void print_lookup(Dictlite * dict, struct Boxint * key)
 {
-  printf("dictlite[%zd] {\n", dictlite_size(dict));
-  DictliteItemIterator iterator = dictlite_itemIterator(dict);
+  // Look up the key only once
+  void * value = NULL;
+  int found = dictlite_tryGet(dict, key, &value);
+  printf("contains %d?: %d; value: \"%s\"\n", key->value, found,
+	 (found ? (char *) value : "(null)"));
+}
+
+static void print_prefix(Dictlite * dict, const char * prefix)
+{
+  printf("keys starting with \"%s\":\n", prefix);
+  DictliteItemIterator iterator = dictlite_prefixIterator(dict, prefix);
   MappingItem * item;
   while ((item = dictlite_itemIterator_next(&iterator))) {
-    object_to_string(item->key, keyTypeCode, keyStringBuffer, STRING_BUFFER_LENGTH);
-    object_to_string(item->value, valueTypeCode, valueStringBuffer, STRING_BUFFER_LENGTH);
-    printf("  %s: %s,\n", keyStringBuffer, valueStringBuffer);
+    printf("  \"%s\"\n", (char *) item->key);
   }
-  printf("}\n");
 }
 
 static int compare_string_string(void * string1, void * string2)
@@ -60,6 +66,23 @@ static int compare_string_string(void * string1, void * string2)
   return strcmp(str1, str2);
 }
 
+static size_t hash_string(void * string)
+{
+  // 64-bit FNV-1a
+  const unsigned char * str = (const unsigned char *) string;
+  unsigned long long hash = 14695981039346656037ULL;
+  while (*str != '\0') {
+    hash ^= *str++;
+    hash *= 1099511628211ULL;
+  }
+  return (size_t) hash;
+}
+
+static void print_eviction(void * key, void * value)
+{
+  printf("evicted \"%s\": \"%s\"\n", (char *) key, (char *) value);
+}
+
 static int compare_boxint_boxint(void * boxint1, void * boxint2)
 {
   struct Boxint * bint1 = (struct Boxint *) boxint1;
@@ -135,8 +158,8 @@ int main()
     rv = 1;
     goto finally;
   }
-  Dictlite * dl3 = dictlite_new(compare_string_string);
-  if (dl2 == NULL) {
+  Dictlite * dl3 = dictlite_newRadixTree();
+  if (dl3 == NULL) {
     printf("Failed to allocate dict 3.\n");
     rv = 1;
     goto finally;
@@ -158,7 +181,7 @@ int main()
   dictlite_setValue(dl3, "album: It's Never Been Like That", "band: Phoenix");
 
   // Print the dict contents
-  dictlite_print(dl1, STRING, STRING);
+  dictlite_print(dl1, dictlite_formatString, dictlite_formatString);
   printf("\n");
 
   // Try out the operations
@@ -169,37 +192,71 @@ int main()
   printf("\n");
 
   // Print the dict contents
-  dictlite_print(dl1, STRING, STRING);
+  dictlite_print(dl1, dictlite_formatString, dictlite_formatString);
   printf("\n");
 
-  dictlite_print(dl2, BOXINT, STRING);
+  dictlite_print(dl2, format_boxint_key, dictlite_formatString);
   printf("\n");
 
   struct Boxint intkey1 = {7};
   struct Boxint intkey2 = {12252};
   struct Boxint intkey3 = {39912};
 
-  printf("contains %d?: %d; value: \"%s\"\n", intkey1.value, dictlite_contains(dl2, &intkey1),
-	 (char *) dictlite_getValue(dl2, &intkey1));
-  printf("contains %d?: %d; value: \"%s\"\n", intkey2.value, dictlite_contains(dl2, &intkey2),
-	 (char *) dictlite_getValue(dl2, &intkey2));
-  printf("contains %d?: %d; value: \"%s\"\n", intkey3.value, dictlite_contains(dl2, &intkey3),
-	 (char *) dictlite_getValue(dl2, &intkey3));
+  print_lookup(dl2, &intkey1);
+  print_lookup(dl2, &intkey2);
+  print_lookup(dl2, &intkey3);
   dictlite_setValue(dl2, &intkey3, "Beijing");
-  printf("contains %d?: %d; value: \"%s\"\n", intkey3.value, dictlite_contains(dl2, &intkey3),
-	 (char *) dictlite_getValue(dl2, &intkey3));
+  print_lookup(dl2, &intkey3);
   printf("\n");
 
-  dictlite_print(dl2, BOXINT, STRING);
+  dictlite_print(dl2, format_boxint_key, dictlite_formatString);
+  printf("\n");
+
+  // Filter out lookups of absent keys
+  if (dictlite_enableFilter(dl1, hash_string, 0) != 0) {
+    printf("Failed to allocate filter.\n");
+    rv = 1;
+    goto finally;
+  }
+  int numFound = 0;
+  for (index = 0; index < 5; ++index) {
+    numFound += dictlite_contains(dl1, ids2[index]);
+    numFound += dictlite_contains(dl1, drugs[index]);
+  }
+  DictliteFilterStats stats = dictlite_filterStats(dl1);
+  printf("found %d of %zd keys; filter rejected %zd; false positive rate: %.2f\n",
+	 numFound, stats.lookups, stats.rejections, dictlite_filterFalsePositiveRate(dl1));
   printf("\n");
 
+  // Use a small cache
+  Dictlite * cache = dictlite_newCache(compare_string_string, hash_string, 3, print_eviction);
+  if (cache == NULL) {
+    printf("Failed to allocate cache.\n");
+    rv = 1;
+    goto finally;
+  }
+  for (index = 0; index < 5; ++index) {
+    dictlite_setValue(cache, drugs[index], conds[index]);
+    // Keep the first drug in use
+    dictlite_getValue(cache, drugs[0]);
+  }
+  DictliteCacheStats cacheStats = dictlite_cacheStats(cache);
+  printf("cache hits: %zd; misses: %zd; evictions: %zd\n",
+	 cacheStats.hits, cacheStats.misses, cacheStats.evictions);
+  dictlite_print(cache, dictlite_formatString, dictlite_formatString);
+  printf("\n");
+  dictlite_del(cache);
+
   // Combine some dicts
-  dictlite_print(dl3, STRING, STRING);
+  dictlite_print(dl3, dictlite_formatString, dictlite_formatString);
+  printf("\n");
+  print_prefix(dl3, "song: ");
+  print_prefix(dl3, "album: It");
   printf("\n");
   dictlite_addFromDict(dl3, dl1);
-  dictlite_print(dl3, STRING, STRING);
+  dictlite_print(dl3, dictlite_formatString, dictlite_formatString);
   printf("\n");
-  dictlite_print(dl1, STRING, STRING);
+  dictlite_print(dl1, dictlite_formatString, dictlite_formatString);
   printf("\n");
 
  finally: